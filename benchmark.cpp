@@ -0,0 +1,998 @@
+// Headless benchmark -- renders fixed workloads into an offscreen target and reports CPU, wall and GPU frame time
+// percentiles as JSON. There's no window or surface, so it runs on software drivers too, e.g.
+//     VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./benchmark --out bench.json
+//
+// Shaders are compiled by the CMake "shaders" target and loaded from --shaders (default: the build's shaders dir).
+//
+// Options:
+//     --frames N          measured frames per scenario (default 200)
+//     --warmup N          unmeasured frames per scenario (default 10)
+//     --scales A,B,C      draw/instance counts, and upload size in KB, all > 0 (default 100,1000,10000)
+//     --device N          physical device index (default: first with a graphics queue)
+//     --shaders DIR       directory holding bench.vert.spv / bench.frag.spv
+//     --out PATH          write JSON here instead of stdout
+//     --baseline PATH     compare against a previous run, exit 1 on regressions or a mismatched baseline
+//     --threshold F       allowed slowdown before flagging, as a fraction (default 0.10)
+//     --min-delta MS      slowdowns smaller than this many ms are never flagged (default 0.10)
+//
+// Only p50/p95 gate the baseline comparison; p99 and startup time are too noisy and are only reported.
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vkHelper.hpp"
+
+#ifndef BENCH_SHADER_DIR
+#define BENCH_SHADER_DIR "shaders"
+#endif
+
+struct BenchOptions {
+    uint32_t warmupFrames = 10;
+    uint32_t frames = 200;
+    std::vector<uint32_t> scales = { 100, 1000, 10000 };
+    std::optional<uint32_t> deviceIndex;
+    std::string shaderDir = BENCH_SHADER_DIR;
+    std::string outPath;
+    std::string baselinePath;
+    double threshold = 0.10;
+    double minDelta = 0.10;
+};
+
+struct Percentiles {
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+struct ScenarioResult {
+    std::string name;
+    // Host work + record + submit
+    Percentiles cpu;
+    // cpu plus the fence wait, i.e. end-to-end frame latency
+    Percentiles wall;
+    std::optional<Percentiles> gpu;
+};
+
+// Nearest-rank percentiles, in ms
+Percentiles computePercentiles(std::vector<double> samples) {
+    Percentiles result;
+    if (samples.empty()) {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto rank = [&samples](double p) {
+        size_t index = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+        return samples[std::min(samples.size(), std::max<size_t>(index, 1)) - 1];
+    };
+    result.p50 = rank(50.0);
+    result.p95 = rank(95.0);
+    result.p99 = rank(99.0);
+    return result;
+}
+
+// Just enough JSON to read back our own output: every number ends up under its dotted path,
+// e.g. "scenarios.draws_1000.cpu.p95", and every string in strings(). Array elements are keyed by index.
+class JsonFlattener {
+public:
+    explicit JsonFlattener(const std::string& text) : mText(text) {}
+
+    std::map<std::string, double> flatten() {
+        value("");
+        return mValues;
+    }
+
+    const std::map<std::string, std::string>& strings() const {
+        return mStrings;
+    }
+
+private:
+    void value(const std::string& path) {
+        skipWhitespace();
+        char c = peek();
+        if (c == '{') {
+            object(path);
+        }
+        else if (c == '[') {
+            array(path);
+        }
+        else if (c == '"') {
+            mStrings[path] = string();
+        }
+        else if (c == 't' || c == 'f' || c == 'n') {
+            while (mPos < mText.size() && isalpha(static_cast<unsigned char>(mText[mPos]))) {
+                mPos++;
+            }
+        }
+        else {
+            const char* begin = mText.c_str() + mPos;
+            char* end = nullptr;
+            double number = strtod(begin, &end);
+            if (end == begin) {
+                throw std::runtime_error("Malformed JSON at offset " + std::to_string(mPos));
+            }
+            mPos += end - begin;
+            mValues[path] = number;
+        }
+    }
+
+    void object(const std::string& path) {
+        expect('{');
+        skipWhitespace();
+        if (peek() == '}') {
+            mPos++;
+            return;
+        }
+        while (true) {
+            skipWhitespace();
+            std::string key = string();
+            skipWhitespace();
+            expect(':');
+            value(path.empty() ? key : path + "." + key);
+            skipWhitespace();
+            if (peek() == ',') {
+                mPos++;
+                continue;
+            }
+            expect('}');
+            return;
+        }
+    }
+
+    void array(const std::string& path) {
+        expect('[');
+        skipWhitespace();
+        if (peek() == ']') {
+            mPos++;
+            return;
+        }
+        for (uint32_t i = 0;; i++) {
+            value(path + "." + std::to_string(i));
+            skipWhitespace();
+            if (peek() == ',') {
+                mPos++;
+                continue;
+            }
+            expect(']');
+            return;
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string result;
+        while (peek() != '"') {
+            if (peek() == '\\') {
+                mPos++;
+            }
+            result += mText[mPos++];
+        }
+        mPos++;
+        return result;
+    }
+
+    void skipWhitespace() {
+        while (mPos < mText.size() && isspace(static_cast<unsigned char>(mText[mPos]))) {
+            mPos++;
+        }
+    }
+
+    char peek() {
+        if (mPos >= mText.size()) {
+            throw std::runtime_error("Unexpected end of JSON");
+        }
+        return mText[mPos];
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            throw std::runtime_error(std::string("Expected '") + c + "' in JSON at offset " + std::to_string(mPos));
+        }
+        mPos++;
+    }
+
+    const std::string& mText;
+    size_t mPos = 0;
+    std::map<std::string, double> mValues;
+    std::map<std::string, std::string> mStrings;
+};
+
+class Benchmark {
+public:
+    int run(const BenchOptions& options, std::chrono::steady_clock::time_point startTime) {
+        mOptions = options;
+
+        init();
+        mStartupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        std::vector<ScenarioResult> results = runScenarios();
+        std::string json = toJson(results);
+
+        if (mOptions.outPath.empty()) {
+            std::cout << json;
+        }
+        else {
+            std::ofstream out(mOptions.outPath);
+            if (out.is_open()) {
+                out << json;
+                out.close();
+            }
+            if (!out) {
+                std::cerr << "Unable to write results to " << mOptions.outPath << std::endl;
+                cleanup();
+                return EXIT_FAILURE;
+            }
+        }
+
+        int exitCode = EXIT_SUCCESS;
+        if (!mOptions.baselinePath.empty()) {
+            exitCode = compareToBaseline(json) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        cleanup();
+        return exitCode;
+    }
+
+private:
+    void init() {
+        // Instance -- no surface extensions, we never present
+        {
+            VkApplicationInfo appInfo{};
+            appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+            appInfo.pApplicationName = "Benchmark";
+            appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+            appInfo.pEngineName = "No Engine";
+            appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+            appInfo.apiVersion = VK_API_VERSION_1_0;
+
+            VkInstanceCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+            createInfo.pApplicationInfo = &appInfo;
+
+            CHECK_VK(vkCreateInstance(&createInfo, nullptr, &mInstance));
+        }
+
+        // Physical Device
+        {
+            uint32_t deviceCount = 0;
+            CHECK_VK(vkEnumeratePhysicalDevices(mInstance, &deviceCount, nullptr));
+            if (deviceCount == 0) {
+                throw std::runtime_error("Couldn't find a physical device");
+            }
+            std::vector<VkPhysicalDevice> devices(deviceCount);
+            CHECK_VK(vkEnumeratePhysicalDevices(mInstance, &deviceCount, devices.data()));
+
+            for (uint32_t i = 0; i < deviceCount; i++) {
+                if (mOptions.deviceIndex.has_value() && mOptions.deviceIndex.value() != i) {
+                    continue;
+                }
+
+                uint32_t queueFamilyCount = 0;
+                vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, nullptr);
+                std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+                vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount, queueFamilies.data());
+
+                for (uint32_t family = 0; family < queueFamilyCount; family++) {
+                    if (queueFamilies[family].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                        mPhysicalDevice = devices[i];
+                        mQueueFamily = family;
+                        mTimestampValidBits = queueFamilies[family].timestampValidBits;
+                        break;
+                    }
+                }
+                if (mPhysicalDevice != VK_NULL_HANDLE) {
+                    break;
+                }
+            }
+            if (mPhysicalDevice == VK_NULL_HANDLE) {
+                throw std::runtime_error("Couldn't find a physical device with a graphics queue");
+            }
+
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+            mDeviceName = properties.deviceName;
+            mTimestampPeriod = properties.limits.timestampPeriod;
+            vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &mMemoryProperties);
+
+            std::cerr << "Benchmarking on " << mDeviceName << std::endl;
+        }
+
+        // Logical Device & Queue
+        {
+            float queuePriority = 1.0f;
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = mQueueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+
+            VkPhysicalDeviceFeatures deviceFeatures = {};
+            VkDeviceCreateInfo deviceInfo = {};
+            deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+            deviceInfo.pQueueCreateInfos = &queueCreateInfo;
+            deviceInfo.queueCreateInfoCount = 1;
+            deviceInfo.pEnabledFeatures = &deviceFeatures;
+
+            CHECK_VK(vkCreateDevice(mPhysicalDevice, &deviceInfo, nullptr, &mLogicalDevice));
+            vkGetDeviceQueue(mLogicalDevice, mQueueFamily, 0, &mQueue);
+        }
+
+        // Command buffer, fence & timestamps
+        {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            poolInfo.queueFamilyIndex = mQueueFamily;
+            CHECK_VK(vkCreateCommandPool(mLogicalDevice, &poolInfo, nullptr, &mCommandPool));
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = mCommandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            CHECK_VK(vkAllocateCommandBuffers(mLogicalDevice, &allocInfo, &mCommandBuffer));
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            CHECK_VK(vkCreateFence(mLogicalDevice, &fenceInfo, nullptr, &mFence));
+
+            if (mTimestampValidBits > 0) {
+                VkQueryPoolCreateInfo queryInfo{};
+                queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+                queryInfo.queryCount = 2;
+                CHECK_VK(vkCreateQueryPool(mLogicalDevice, &queryInfo, nullptr, &mQueryPool));
+            }
+            else {
+                std::cerr << "Queue has no timestamp support, GPU times will be omitted" << std::endl;
+            }
+        }
+
+        // Render Pass
+        {
+            VkAttachmentDescription colorAttachment{};
+            colorAttachment.format = sTargetFormat;
+            colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            VkAttachmentReference colorReference{};
+            colorReference.attachment = 0;
+            colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            VkSubpassDescription subpass{};
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.colorAttachmentCount = 1;
+            subpass.pColorAttachments = &colorReference;
+
+            VkRenderPassCreateInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            renderPassInfo.attachmentCount = 1;
+            renderPassInfo.pAttachments = &colorAttachment;
+            renderPassInfo.subpassCount = 1;
+            renderPassInfo.pSubpasses = &subpass;
+            CHECK_VK(vkCreateRenderPass(mLogicalDevice, &renderPassInfo, nullptr, &mRenderPass));
+        }
+
+        // Pipeline
+        {
+            VkShaderModule vertModule = createShaderModule(mOptions.shaderDir + "/bench.vert.spv");
+            VkShaderModule fragModule = createShaderModule(mOptions.shaderDir + "/bench.frag.spv");
+
+            VkPipelineShaderStageCreateInfo stages[2] = {};
+            stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+            stages[0].module = vertModule;
+            stages[0].pName = "main";
+            stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            stages[1].module = fragModule;
+            stages[1].pName = "main";
+
+            // Vertices come from gl_VertexIndex
+            VkPipelineVertexInputStateCreateInfo vertexInput{};
+            vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+            VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+            inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+            inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+            // Dynamic so the resize scenario doesn't need a pipeline per size
+            VkPipelineViewportStateCreateInfo viewportState{};
+            viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+            viewportState.viewportCount = 1;
+            viewportState.scissorCount = 1;
+
+            VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+            VkPipelineDynamicStateCreateInfo dynamicState{};
+            dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+            dynamicState.dynamicStateCount = 2;
+            dynamicState.pDynamicStates = dynamicStates;
+
+            VkPipelineRasterizationStateCreateInfo rasterizer{};
+            rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+            rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+            rasterizer.cullMode = VK_CULL_MODE_NONE;
+            rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+            rasterizer.lineWidth = 1.0f;
+
+            VkPipelineMultisampleStateCreateInfo multisampling{};
+            multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+            multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            VkPipelineColorBlendAttachmentState blendAttachment{};
+            blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+            VkPipelineColorBlendStateCreateInfo colorBlending{};
+            colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+            colorBlending.attachmentCount = 1;
+            colorBlending.pAttachments = &blendAttachment;
+
+            VkPushConstantRange pushConstant{};
+            pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            pushConstant.offset = 0;
+            pushConstant.size = sizeof(uint32_t);
+
+            VkPipelineLayoutCreateInfo layoutInfo{};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            layoutInfo.pushConstantRangeCount = 1;
+            layoutInfo.pPushConstantRanges = &pushConstant;
+            CHECK_VK(vkCreatePipelineLayout(mLogicalDevice, &layoutInfo, nullptr, &mPipelineLayout));
+
+            VkGraphicsPipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            pipelineInfo.stageCount = 2;
+            pipelineInfo.pStages = stages;
+            pipelineInfo.pVertexInputState = &vertexInput;
+            pipelineInfo.pInputAssemblyState = &inputAssembly;
+            pipelineInfo.pViewportState = &viewportState;
+            pipelineInfo.pRasterizationState = &rasterizer;
+            pipelineInfo.pMultisampleState = &multisampling;
+            pipelineInfo.pColorBlendState = &colorBlending;
+            pipelineInfo.pDynamicState = &dynamicState;
+            pipelineInfo.layout = mPipelineLayout;
+            pipelineInfo.renderPass = mRenderPass;
+            pipelineInfo.subpass = 0;
+            CHECK_VK(vkCreateGraphicsPipelines(mLogicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mPipeline));
+
+            vkDestroyShaderModule(mLogicalDevice, vertModule, nullptr);
+            vkDestroyShaderModule(mLogicalDevice, fragModule, nullptr);
+        }
+
+        createTarget(sTargetSizes[0]);
+    }
+
+    void cleanup() {
+        CHECK_VK(vkDeviceWaitIdle(mLogicalDevice));
+
+        destroyTarget();
+        vkDestroyPipeline(mLogicalDevice, mPipeline, nullptr);
+        vkDestroyPipelineLayout(mLogicalDevice, mPipelineLayout, nullptr);
+        vkDestroyRenderPass(mLogicalDevice, mRenderPass, nullptr);
+        if (mQueryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(mLogicalDevice, mQueryPool, nullptr);
+        }
+        vkDestroyFence(mLogicalDevice, mFence, nullptr);
+        vkDestroyCommandPool(mLogicalDevice, mCommandPool, nullptr);
+        vkDestroyDevice(mLogicalDevice, nullptr);
+        vkDestroyInstance(mInstance, nullptr);
+    }
+
+    std::vector<ScenarioResult> runScenarios() {
+        std::vector<ScenarioResult> results;
+
+        results.push_back(runScenario("empty", nullptr, [this](VkCommandBuffer commandBuffer) {
+            recordPass(commandBuffer, [](VkCommandBuffer) {});
+        }));
+
+        for (uint32_t scale : mOptions.scales) {
+            results.push_back(runScenario("draws_" + std::to_string(scale), nullptr, [this, scale](VkCommandBuffer commandBuffer) {
+                recordPass(commandBuffer, [this, scale](VkCommandBuffer commandBuffer) {
+                    for (uint32_t i = 0; i < scale; i++) {
+                        vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &i);
+                        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                    }
+                });
+            }));
+        }
+
+        for (uint32_t scale : mOptions.scales) {
+            results.push_back(runScenario("instances_" + std::to_string(scale), nullptr, [this, scale](VkCommandBuffer commandBuffer) {
+                recordPass(commandBuffer, [this, scale](VkCommandBuffer commandBuffer) {
+                    uint32_t drawIndex = 0;
+                    vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &drawIndex);
+                    vkCmdDraw(commandBuffer, 3, scale, 0, 0);
+                });
+            }));
+        }
+
+        // Host write into a staging buffer, then a copy into device local memory, every frame
+        for (uint32_t scale : mOptions.scales) {
+            VkDeviceSize size = static_cast<VkDeviceSize>(scale) * 1024;
+            VkBuffer staging, destination;
+            VkDeviceMemory stagingMemory, destinationMemory;
+            createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, stagingMemory);
+            createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, destination, destinationMemory);
+
+            uint8_t* mapped = nullptr;
+            CHECK_VK(vkMapMemory(mLogicalDevice, stagingMemory, 0, size, 0, reinterpret_cast<void**>(&mapped)));
+
+            uint32_t frame = 0;
+            results.push_back(runScenario("upload_" + std::to_string(scale) + "KB", [mapped, size, &frame]() {
+                memset(mapped, static_cast<int>(frame++ & 0xFF), size);
+            }, [staging, destination, size](VkCommandBuffer commandBuffer) {
+                VkBufferCopy region{};
+                region.size = size;
+                vkCmdCopyBuffer(commandBuffer, staging, destination, 1, &region);
+            }));
+
+            vkUnmapMemory(mLogicalDevice, stagingMemory);
+            vkDestroyBuffer(mLogicalDevice, staging, nullptr);
+            vkFreeMemory(mLogicalDevice, stagingMemory, nullptr);
+            vkDestroyBuffer(mLogicalDevice, destination, nullptr);
+            vkFreeMemory(mLogicalDevice, destinationMemory, nullptr);
+        }
+
+        // Render target torn down and rebuilt at a different size every frame
+        {
+            uint32_t frame = 0;
+            results.push_back(runScenario("resize", [this, &frame]() {
+                destroyTarget();
+                createTarget(sTargetSizes[++frame % sTargetSizes.size()]);
+            }, [this](VkCommandBuffer commandBuffer) {
+                recordPass(commandBuffer, [](VkCommandBuffer) {});
+            }));
+
+            destroyTarget();
+            createTarget(sTargetSizes[0]);
+        }
+
+        return results;
+    }
+
+    // One submit per frame, waited on before the next. CPU time stops at vkQueueSubmit, wall time at the fence.
+    ScenarioResult runScenario(
+        const std::string& name,
+        const std::function<void()>& hostWork,
+        const std::function<void(VkCommandBuffer)>& record) {
+
+        std::vector<double> cpuTimes;
+        std::vector<double> wallTimes;
+        std::vector<double> gpuTimes;
+
+        for (uint32_t frame = 0; frame < mOptions.warmupFrames + mOptions.frames; frame++) {
+            auto start = std::chrono::steady_clock::now();
+
+            if (hostWork) {
+                hostWork();
+            }
+
+            CHECK_VK(vkResetCommandBuffer(mCommandBuffer, 0));
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            CHECK_VK(vkBeginCommandBuffer(mCommandBuffer, &beginInfo));
+
+            if (mQueryPool != VK_NULL_HANDLE) {
+                vkCmdResetQueryPool(mCommandBuffer, mQueryPool, 0, 2);
+                vkCmdWriteTimestamp(mCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, 0);
+            }
+            record(mCommandBuffer);
+            if (mQueryPool != VK_NULL_HANDLE) {
+                vkCmdWriteTimestamp(mCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, 1);
+            }
+
+            CHECK_VK(vkEndCommandBuffer(mCommandBuffer));
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &mCommandBuffer;
+            CHECK_VK(vkQueueSubmit(mQueue, 1, &submitInfo, mFence));
+            auto submitted = std::chrono::steady_clock::now();
+            CHECK_VK(vkWaitForFences(mLogicalDevice, 1, &mFence, VK_TRUE, UINT64_MAX));
+            CHECK_VK(vkResetFences(mLogicalDevice, 1, &mFence));
+
+            auto end = std::chrono::steady_clock::now();
+            if (frame < mOptions.warmupFrames) {
+                continue;
+            }
+
+            cpuTimes.push_back(std::chrono::duration<double, std::milli>(submitted - start).count());
+            wallTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+            if (mQueryPool != VK_NULL_HANDLE) {
+                uint64_t timestamps[2];
+                CHECK_VK(vkGetQueryPoolResults(mLogicalDevice, mQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+                uint64_t mask = mTimestampValidBits >= 64 ? UINT64_MAX : (1ull << mTimestampValidBits) - 1;
+                uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+                gpuTimes.push_back(static_cast<double>(ticks) * mTimestampPeriod / 1e6);
+            }
+        }
+
+        ScenarioResult result;
+        result.name = name;
+        result.cpu = computePercentiles(cpuTimes);
+        result.wall = computePercentiles(wallTimes);
+        if (mQueryPool != VK_NULL_HANDLE) {
+            result.gpu = computePercentiles(gpuTimes);
+        }
+
+        std::cerr << "\t" << name << ": cpu p50 " << result.cpu.p50 << " ms" << std::endl;
+        return result;
+    }
+
+    void recordPass(VkCommandBuffer commandBuffer, const std::function<void(VkCommandBuffer)>& draws) {
+        VkClearValue clearColor = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+
+        VkRenderPassBeginInfo passInfo{};
+        passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        passInfo.renderPass = mRenderPass;
+        passInfo.framebuffer = mTarget.framebuffer;
+        passInfo.renderArea.offset = { 0, 0 };
+        passInfo.renderArea.extent = mTarget.extent;
+        passInfo.clearValueCount = 1;
+        passInfo.pClearValues = &clearColor;
+        vkCmdBeginRenderPass(commandBuffer, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(mTarget.extent.width);
+        viewport.height = static_cast<float>(mTarget.extent.height);
+        viewport.maxDepth = 1.0f;
+        VkRect2D scissor{ { 0, 0 }, mTarget.extent };
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipeline);
+
+        draws(commandBuffer);
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    void createTarget(VkExtent2D extent) {
+        mTarget.extent = extent;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { extent.width, extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = sTargetFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        CHECK_VK(vkCreateImage(mLogicalDevice, &imageInfo, nullptr, &mTarget.image));
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(mLogicalDevice, mTarget.image, &memRequirements);
+
+        VkMemoryAllocateInfo memInfo{};
+        memInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memInfo.allocationSize = memRequirements.size;
+        memInfo.memoryTypeIndex = findMemoryType(mMemoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CHECK_VK(vkAllocateMemory(mLogicalDevice, &memInfo, nullptr, &mTarget.memory));
+        CHECK_VK(vkBindImageMemory(mLogicalDevice, mTarget.image, mTarget.memory, 0));
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = mTarget.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = sTargetFormat;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        CHECK_VK(vkCreateImageView(mLogicalDevice, &viewInfo, nullptr, &mTarget.view));
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = mRenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &mTarget.view;
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
+        CHECK_VK(vkCreateFramebuffer(mLogicalDevice, &framebufferInfo, nullptr, &mTarget.framebuffer));
+    }
+
+    void destroyTarget() {
+        vkDestroyFramebuffer(mLogicalDevice, mTarget.framebuffer, nullptr);
+        vkDestroyImageView(mLogicalDevice, mTarget.view, nullptr);
+        vkDestroyImage(mLogicalDevice, mTarget.image, nullptr);
+        vkFreeMemory(mLogicalDevice, mTarget.memory, nullptr);
+        mTarget = {};
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        CHECK_VK(vkCreateBuffer(mLogicalDevice, &bufferInfo, nullptr, &buffer));
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(mLogicalDevice, buffer, &memRequirements);
+
+        VkMemoryAllocateInfo memInfo{};
+        memInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memInfo.allocationSize = memRequirements.size;
+        memInfo.memoryTypeIndex = findMemoryType(mMemoryProperties, memRequirements.memoryTypeBits, properties);
+        CHECK_VK(vkAllocateMemory(mLogicalDevice, &memInfo, nullptr, &memory));
+        CHECK_VK(vkBindBufferMemory(mLogicalDevice, buffer, memory, 0));
+    }
+
+    VkShaderModule createShaderModule(const std::string& path) {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open shader " + path);
+        }
+        size_t size = static_cast<size_t>(file.tellg());
+        std::vector<uint32_t> code((size + 3) / 4);
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(code.data()), size);
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = size;
+        createInfo.pCode = code.data();
+
+        VkShaderModule module;
+        CHECK_VK(vkCreateShaderModule(mLogicalDevice, &createInfo, nullptr, &module));
+        return module;
+    }
+
+    std::string toJson(const std::vector<ScenarioResult>& results) {
+        auto percentiles = [](std::ostream& out, const Percentiles& p) {
+            out << "{ \"p50\": " << p.p50 << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << " }";
+        };
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(4);
+        out << "{\n";
+        out << "  \"device\": \"" << mDeviceName << "\",\n";
+        out << "  \"frames\": " << mOptions.frames << ",\n";
+        out << "  \"startupMs\": " << mStartupMs << ",\n";
+        out << "  \"scenarios\": {\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const ScenarioResult& result = results[i];
+            out << "    \"" << result.name << "\": {\n";
+            out << "      \"cpu\": ";
+            percentiles(out, result.cpu);
+            out << ",\n      \"wall\": ";
+            percentiles(out, result.wall);
+            if (result.gpu.has_value()) {
+                out << ",\n      \"gpu\": ";
+                percentiles(out, result.gpu.value());
+            }
+            out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  }\n";
+        out << "}\n";
+        return out.str();
+    }
+
+    // Flags p50/p95 timings that got slower than baseline * (1 + threshold) and by more than minDelta ms; p99 and
+    // startup slowdowns are printed but don't count. Returns false on any regression, if the frame counts differ,
+    // or if a baseline timing has no counterpart in this run.
+    bool compareToBaseline(const std::string& json) {
+        std::ifstream file(mOptions.baselinePath);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open baseline " + mOptions.baselinePath);
+        }
+        std::stringstream baselineText;
+        baselineText << file.rdbuf();
+        std::string baselineString = baselineText.str();
+
+        JsonFlattener baselineParser(baselineString);
+        JsonFlattener currentParser(json);
+        std::map<std::string, double> baseline = baselineParser.flatten();
+        std::map<std::string, double> current = currentParser.flatten();
+
+        auto baselineDevice = baselineParser.strings().find("device");
+        if (baselineDevice == baselineParser.strings().end() || baselineDevice->second != mDeviceName) {
+            std::cerr << "WARNING baseline was recorded on "
+                      << (baselineDevice == baselineParser.strings().end() ? std::string("an unknown device") : baselineDevice->second)
+                      << ", this run is on " << mDeviceName << std::endl;
+        }
+
+        uint32_t mismatches = 0;
+        if (baseline.count("frames") == 0 || baseline["frames"] != current["frames"]) {
+            std::cerr << "MISMATCH baseline has " << (baseline.count("frames") ? std::to_string(baseline["frames"]) : std::string("no"))
+                      << " frames, this run has " << mOptions.frames << std::endl;
+            mismatches++;
+        }
+        for (const auto& [key, value] : baseline) {
+            if (key != "frames" && current.count(key) == 0) {
+                std::cerr << "MISMATCH " << key << " is in the baseline but not in this run" << std::endl;
+                mismatches++;
+            }
+        }
+
+        uint32_t regressions = 0;
+        for (const auto& [key, value] : current) {
+            if (key == "frames") {
+                continue;
+            }
+            auto base = baseline.find(key);
+            if (base == baseline.end()) {
+                std::cerr << "\t" << key << ": not in baseline" << std::endl;
+                continue;
+            }
+            bool slower = base->second > 0.0 && value > base->second * (1.0 + mOptions.threshold) &&
+                          value - base->second > mOptions.minDelta;
+            if (!slower) {
+                continue;
+            }
+
+            bool gated = key.size() > 4 && (key.compare(key.size() - 4, 4, ".p50") == 0 || key.compare(key.size() - 4, 4, ".p95") == 0);
+            std::cerr << (gated ? "REGRESSION " : "NOTE ") << key << ": " << base->second << " -> " << value
+                      << " ms (+" << (value / base->second - 1.0) * 100.0 << "%)" << std::endl;
+            if (gated) {
+                regressions++;
+            }
+        }
+
+        std::cerr << regressions << " regression(s), " << mismatches << " mismatch(es) against " << mOptions.baselinePath << std::endl;
+        return regressions == 0 && mismatches == 0;
+    }
+
+    struct RenderTarget {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent = { 0, 0 };
+    };
+
+    static constexpr VkFormat sTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    const std::vector<VkExtent2D> sTargetSizes = { { 1024, 1024 }, { 1280, 720 }, { 640, 480 }, { 1920, 1080 } };
+
+    BenchOptions mOptions;
+    double mStartupMs = 0.0;
+
+    VkInstance mInstance;
+    VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties mMemoryProperties;
+    std::string mDeviceName;
+    uint32_t mQueueFamily = 0;
+    uint32_t mTimestampValidBits = 0;
+    float mTimestampPeriod = 1.0f;
+
+    VkDevice mLogicalDevice;
+    VkQueue mQueue;
+
+    VkCommandPool mCommandPool;
+    VkCommandBuffer mCommandBuffer;
+    VkFence mFence;
+    VkQueryPool mQueryPool = VK_NULL_HANDLE;
+
+    VkRenderPass mRenderPass;
+    VkPipelineLayout mPipelineLayout;
+    VkPipeline mPipeline;
+    RenderTarget mTarget;
+};
+
+// Whole string must be a non-negative integer that fits in 32 bits, unlike plain stoul
+uint32_t parseUint(const std::string& value) {
+    size_t consumed = 0;
+    if (value.empty() || value[0] == '-') {
+        throw std::invalid_argument(value);
+    }
+    unsigned long long result = std::stoull(value, &consumed);
+    if (consumed != value.size()) {
+        throw std::invalid_argument(value);
+    }
+    if (result > UINT32_MAX) {
+        throw std::out_of_range(value);
+    }
+    return static_cast<uint32_t>(result);
+}
+
+int main(int argc, char** argv) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::string value = argv[++i];
+
+        try {
+            if (arg == "--frames") {
+                options.frames = parseUint(value);
+            }
+            else if (arg == "--warmup") {
+                options.warmupFrames = parseUint(value);
+            }
+            else if (arg == "--scales") {
+                options.scales.clear();
+                std::stringstream list(value);
+                std::string scale;
+                while (std::getline(list, scale, ',')) {
+                    // Zero would mean a zero-sized upload buffer, which isn't valid Vulkan
+                    uint32_t parsed = parseUint(scale);
+                    if (parsed == 0) {
+                        throw std::invalid_argument(scale);
+                    }
+                    options.scales.push_back(parsed);
+                }
+                if (options.scales.empty()) {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (arg == "--device") {
+                options.deviceIndex = parseUint(value);
+            }
+            else if (arg == "--shaders") {
+                options.shaderDir = value;
+            }
+            else if (arg == "--out") {
+                options.outPath = value;
+            }
+            else if (arg == "--baseline") {
+                options.baselinePath = value;
+            }
+            else if (arg == "--threshold") {
+                size_t consumed = 0;
+                options.threshold = std::stod(value, &consumed);
+                if (consumed != value.size() || options.threshold < 0.0) {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (arg == "--min-delta") {
+                size_t consumed = 0;
+                options.minDelta = std::stod(value, &consumed);
+                if (consumed != value.size() || options.minDelta < 0.0) {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        catch (const std::invalid_argument&) {
+            std::cerr << "Invalid value '" << value << "' for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+        catch (const std::out_of_range&) {
+            std::cerr << "Value '" << value << "' out of range for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Benchmark benchmark;
+    try {
+        return benchmark.run(options, startTime);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -4,22 +4,31 @@
 #include <glm/glm.hpp>
 
 #include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
 #include <set>
 #include <cstdint> 
+#include <chrono>
+#include <string>
 
 #include "vkHelper.hpp"
+#include "textureStreamer.hpp"
 
 class HelloTriangleApplication {
 public:
-    void run() {
+    void run(const std::vector<std::string>& texturePaths) {
 #ifdef _DEBUG
         mEnableValidationLayers = true;
 #endif
+        mStartTime = std::chrono::steady_clock::now();
         init();
+        for (const std::string& path : texturePaths) {
+            mTextures.push_back(mTextureStreamer.request(path));
+        }
         mainLoop();
         cleanup();
     }
@@ -306,15 +315,30 @@ private:
             mSwapChainImages.resize(swapChainImages);
             CHECK_VK(vkGetSwapchainImagesKHR(mLogicalDevice, mSwapChain, &swapChainImages, mSwapChainImages.data()));
         }
+
+        // Texture Streaming
+        {
+            QueueFamilyIndices indices = getQueueIndices(mPhysicalDevice);
+            mTextureStreamer.init(mPhysicalDevice, mLogicalDevice, mGraphicsQueue, indices.graphicsFamily.value());
+        }
     }
 
     void mainLoop() {
+        bool firstFrame = true;
         while (!glfwWindowShouldClose(mWindow)) {
             glfwPollEvents();
+            mTextureStreamer.update();
+
+            if (firstFrame) {
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStartTime).count();
+                std::cout << "Time to first frame: " << ms << " ms" << std::endl;
+                firstFrame = false;
+            }
         }
     }
 
     void cleanup() {
+        mTextureStreamer.cleanup();
         vkDestroySwapchainKHR(mLogicalDevice, mSwapChain, nullptr);
         vkDestroyDevice(mLogicalDevice, nullptr);
 
@@ -418,12 +442,17 @@ private:
     std::vector<VkImage> mSwapChainImages;
     VkSurfaceFormatKHR mSwapChainSurfaceFormat;
     VkExtent2D mSwapChainExtent;
+
+    TextureStreamer mTextureStreamer;
+    std::vector<uint32_t> mTextures;
+
+    std::chrono::steady_clock::time_point mStartTime;
 };
 
-int main() {
+int main(int argc, char** argv) {
     HelloTriangleApplication app;
 
-    app.run();
+    app.run(std::vector<std::string>(argv + 1, argv + argc));
 
     return EXIT_SUCCESS;
 }
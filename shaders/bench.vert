@@ -0,0 +1,23 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    uint drawIndex;
+} pc;
+
+layout(location = 0) out vec3 fragColor;
+
+const vec2 positions[3] = vec2[](
+    vec2(0.0, -0.01),
+    vec2(0.01, 0.01),
+    vec2(-0.01, 0.01)
+);
+
+void main() {
+    // Spread draws/instances over a 100x100 grid so every one of them covers some pixels
+    uint index = pc.drawIndex + uint(gl_InstanceIndex);
+    vec2 offset = vec2(float(index % 100u), float((index / 100u) % 100u)) * 0.02 - 0.99;
+    gl_Position = vec4(positions[gl_VertexIndex] + offset, 0.0, 1.0);
+
+    float hue = fract(float(index) * 0.618034);
+    fragColor = vec3(hue, 0.5, 1.0 - hue);
+}
@@ -0,0 +1,4 @@
+// stb_image implementation, kept in its own translation unit so headers can include stb_image.h freely.
+// stb_image.h isn't vendored, see README.md
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
@@ -0,0 +1,813 @@
+// Texture streaming -- decodes on worker threads, uploads on the main thread
+// within a per-frame byte budget. Smallest mips go first so a texture can be
+// sampled through its view long before its base level arrives. Sources without
+// mips get a small tail (<= sTailSize) built on the decode thread; the levels
+// between that and the base are blitted on the GPU once the base is in.
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vkHelper.hpp"
+
+struct StreamedTexture {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    // Only covers mips residentMip..mipLevels-1, which are all in SHADER_READ_ONLY_OPTIMAL. Recreated whenever
+    // residentMip drops; the old view stays alive for sFramesInFlight more update() calls. Null until resident.
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = { 0, 0 };
+    uint32_t mipLevels = 0;
+    // Finest mip that is uploaded and sampleable. Equal to mipLevels while nothing is resident.
+    uint32_t residentMip = 0;
+
+    bool isResident() const {
+        return image != VK_NULL_HANDLE && residentMip < mipLevels;
+    }
+};
+
+class TextureStreamer {
+public:
+    void init(
+        VkPhysicalDevice physicalDevice,
+        VkDevice logicalDevice,
+        VkQueue queue,
+        uint32_t queueFamily,
+        VkDeviceSize frameBudget = sDefaultFrameBudget,
+        uint32_t decodeThreads = 0) {
+
+        mPhysicalDevice = physicalDevice;
+        mLogicalDevice = logicalDevice;
+        mQueue = queue;
+
+        vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &mMemoryProperties);
+
+        // Budget has to fit at least one row of the widest possible image, since that's our smallest copy
+        {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+            mMaxImageDimension = properties.limits.maxImageDimension2D;
+            mFrameBudget = std::max(frameBudget, static_cast<VkDeviceSize>(mMaxImageDimension) * sTexelSize);
+        }
+
+        // Mip generation blits from the formats themselves
+        mBlitFilter = VK_FILTER_LINEAR;
+        for (VkFormat format : { sSrgbFormat, sUnormFormat }) {
+            VkFormatProperties formatProperties;
+            vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format, &formatProperties);
+            VkFormatFeatureFlags features = formatProperties.optimalTilingFeatures;
+            if (!(features & VK_FORMAT_FEATURE_BLIT_SRC_BIT) || !(features & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+                throw std::runtime_error("Texture format doesn't support blits");
+            }
+            if (!(features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+                mBlitFilter = VK_FILTER_NEAREST;
+            }
+        }
+
+        // Command pool
+        {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            poolInfo.queueFamilyIndex = queueFamily;
+            CHECK_VK(vkCreateCommandPool(mLogicalDevice, &poolInfo, nullptr, &mCommandPool));
+        }
+
+        // Per-frame command buffer, fence and staging buffer
+        for (FrameSlot& slot : mFrames) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = mCommandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            CHECK_VK(vkAllocateCommandBuffers(mLogicalDevice, &allocInfo, &slot.commandBuffer));
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+            CHECK_VK(vkCreateFence(mLogicalDevice, &fenceInfo, nullptr, &slot.fence));
+
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = mFrameBudget;
+            bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            CHECK_VK(vkCreateBuffer(mLogicalDevice, &bufferInfo, nullptr, &slot.staging));
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(mLogicalDevice, slot.staging, &memRequirements);
+
+            VkMemoryAllocateInfo memInfo{};
+            memInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            memInfo.allocationSize = memRequirements.size;
+            memInfo.memoryTypeIndex = findMemoryType(mMemoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            CHECK_VK(vkAllocateMemory(mLogicalDevice, &memInfo, nullptr, &slot.stagingMemory));
+            CHECK_VK(vkBindBufferMemory(mLogicalDevice, slot.staging, slot.stagingMemory, 0));
+            CHECK_VK(vkMapMemory(mLogicalDevice, slot.stagingMemory, 0, mFrameBudget, 0, reinterpret_cast<void**>(&slot.mapped)));
+        }
+
+        // Decode pool
+        if (decodeThreads == 0) {
+            decodeThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+        for (uint32_t i = 0; i < decodeThreads; i++) {
+            mDecodeThreads.emplace_back(&TextureStreamer::decodeWorker, this);
+        }
+    }
+
+    // Queues a file for decoding and returns a handle for get(). Supports anything stb_image reads,
+    // plus uncompressed RGBA8 KTX files which may carry their own mip chain.
+    uint32_t request(const std::string& path) {
+        uint32_t id = static_cast<uint32_t>(mTextures.size());
+        mTextures.emplace_back();
+
+        if (!mStreaming) {
+            mStreaming = true;
+            mBytesStreamed = 0;
+            mStreamStart = std::chrono::steady_clock::now();
+        }
+        mOutstandingDecodes++;
+
+        {
+            std::lock_guard<std::mutex> lock(mDecodeMutex);
+            mDecodeJobs.push_back({ id, path });
+        }
+        mDecodeCondition.notify_one();
+
+        return id;
+    }
+
+    // Returned by value -- request() can grow the texture list and would invalidate a reference
+    StreamedTexture get(uint32_t id) const {
+        return mTextures[id];
+    }
+
+    // Call once per frame: publishes finished mips, creates images for newly decoded textures, and records
+    // at most mFrameBudget bytes of copies.
+    void update() {
+        mFrameIndex = (mFrameIndex + 1) % sFramesInFlight;
+        FrameSlot& slot = mFrames[mFrameIndex];
+
+        mUpdateCount++;
+        destroyRetiredViews();
+
+        CHECK_VK(vkWaitForFences(mLogicalDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+        publishResidency(slot);
+
+        // Pick up decoded images
+        std::vector<DecodeResult> results;
+        {
+            std::lock_guard<std::mutex> lock(mResultMutex);
+            results.swap(mDecodeResults);
+        }
+        mOutstandingDecodes -= static_cast<uint32_t>(results.size());
+
+        if (results.empty() && mUploads.empty()) {
+            if (mStreaming && mOutstandingDecodes == 0) {
+                reportBandwidth();
+            }
+            return;
+        }
+
+        CHECK_VK(vkResetCommandBuffer(slot.commandBuffer, 0));
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        CHECK_VK(vkBeginCommandBuffer(slot.commandBuffer, &beginInfo));
+
+        for (DecodeResult& result : results) {
+            if (result.levels.empty()) {
+                std::cerr << "Failed to decode texture " << result.path << std::endl;
+                continue;
+            }
+            if (!createTexture(slot.commandBuffer, result)) {
+                std::cerr << "Failed to create image for texture " << result.path << std::endl;
+            }
+        }
+
+        // Fill the budget, always continuing whichever upload has the smallest pending mip
+        VkDeviceSize offset = 0;
+        while (!mUploads.empty()) {
+            auto upload = std::min_element(mUploads.begin(), mUploads.end(), [](const Upload& a, const Upload& b) {
+                return a.pendingBytes() < b.pendingBytes();
+            });
+
+            uint32_t mip = upload->plan[upload->planIndex];
+            VkExtent2D extent = mipExtent(mTextures[upload->textureId].extent, mip);
+            VkDeviceSize rowBytes = static_cast<VkDeviceSize>(extent.width) * sTexelSize;
+            uint32_t rowsFit = static_cast<uint32_t>((mFrameBudget - offset) / rowBytes);
+            if (rowsFit == 0) {
+                break;
+            }
+            uint32_t rows = std::min(extent.height - upload->rowCursor, rowsFit);
+            VkDeviceSize bytes = rows * rowBytes;
+
+            memcpy(slot.mapped + offset, upload->levels[mip].data() + upload->rowCursor * rowBytes, bytes);
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = mip;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, static_cast<int32_t>(upload->rowCursor), 0 };
+            region.imageExtent = { extent.width, rows, 1 };
+            vkCmdCopyBufferToImage(slot.commandBuffer, slot.staging, mTextures[upload->textureId].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            offset += bytes;
+            mBytesStreamed += bytes;
+            upload->rowCursor += rows;
+
+            if (upload->rowCursor == extent.height) {
+                finishMip(slot, *upload, mip);
+                upload->rowCursor = 0;
+                upload->planIndex++;
+                if (upload->planIndex == upload->plan.size()) {
+                    mUploads.erase(upload);
+                }
+            }
+        }
+
+        CHECK_VK(vkEndCommandBuffer(slot.commandBuffer));
+
+        CHECK_VK(vkResetFences(mLogicalDevice, 1, &slot.fence));
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &slot.commandBuffer;
+        CHECK_VK(vkQueueSubmit(mQueue, 1, &submitInfo, slot.fence));
+    }
+
+    void cleanup() {
+        {
+            std::lock_guard<std::mutex> lock(mDecodeMutex);
+            mStopDecoding = true;
+        }
+        mDecodeCondition.notify_all();
+        for (std::thread& thread : mDecodeThreads) {
+            thread.join();
+        }
+        mDecodeThreads.clear();
+
+        CHECK_VK(vkDeviceWaitIdle(mLogicalDevice));
+
+        for (const RetiredView& retired : mRetiredViews) {
+            vkDestroyImageView(mLogicalDevice, retired.view, nullptr);
+        }
+        mRetiredViews.clear();
+
+        for (StreamedTexture& texture : mTextures) {
+            if (texture.view != VK_NULL_HANDLE) {
+                vkDestroyImageView(mLogicalDevice, texture.view, nullptr);
+            }
+            if (texture.image != VK_NULL_HANDLE) {
+                vkDestroyImage(mLogicalDevice, texture.image, nullptr);
+                vkFreeMemory(mLogicalDevice, texture.memory, nullptr);
+            }
+        }
+        mTextures.clear();
+        mUploads.clear();
+
+        for (FrameSlot& slot : mFrames) {
+            vkUnmapMemory(mLogicalDevice, slot.stagingMemory);
+            vkDestroyBuffer(mLogicalDevice, slot.staging, nullptr);
+            vkFreeMemory(mLogicalDevice, slot.stagingMemory, nullptr);
+            vkDestroyFence(mLogicalDevice, slot.fence, nullptr);
+        }
+        vkDestroyCommandPool(mLogicalDevice, mCommandPool, nullptr);
+    }
+
+    uint64_t bytesStreamed() const {
+        return mBytesStreamed;
+    }
+
+    static constexpr VkDeviceSize sDefaultFrameBudget = 4 * 1024 * 1024;
+
+private:
+    struct DecodeJob {
+        uint32_t textureId;
+        std::string path;
+    };
+
+    struct DecodeResult {
+        uint32_t textureId;
+        std::string path;
+        VkExtent2D extent;
+        VkFormat format;
+        // RGBA8 pixels indexed by mip. Levels 1..blitMips are left empty and generated on the GPU from the base.
+        std::vector<std::vector<uint8_t>> levels;
+        uint32_t blitMips = 0;
+    };
+
+    struct Upload {
+        uint32_t textureId;
+        std::vector<std::vector<uint8_t>> levels;
+        // Mips in upload order, smallest first
+        std::vector<uint32_t> plan;
+        uint32_t planIndex = 0;
+        uint32_t rowCursor = 0;
+        uint32_t blitMips = 0;
+
+        size_t pendingBytes() const {
+            return levels[plan[planIndex]].size();
+        }
+    };
+
+    struct Residency {
+        uint32_t textureId;
+        uint32_t mip;
+    };
+
+    struct RetiredView {
+        VkImageView view;
+        uint64_t retiredAt;
+    };
+
+    struct FrameSlot {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkBuffer staging = VK_NULL_HANDLE;
+        VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+        uint8_t* mapped = nullptr;
+        // Mips that become sampleable once this slot's fence signals
+        std::vector<Residency> residency;
+    };
+
+    static uint32_t fullMipCount(VkExtent2D extent) {
+        uint32_t levels = 1;
+        for (uint32_t size = std::max(extent.width, extent.height); size > 1; size >>= 1) {
+            levels++;
+        }
+        return levels;
+    }
+
+    static VkExtent2D mipExtent(VkExtent2D extent, uint32_t mip) {
+        return { std::max(1u, extent.width >> mip), std::max(1u, extent.height >> mip) };
+    }
+
+    // Runs on the decode threads -- no VK calls in here
+    void decodeWorker() {
+        while (true) {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(mDecodeMutex);
+                mDecodeCondition.wait(lock, [this] { return mStopDecoding || !mDecodeJobs.empty(); });
+                if (mStopDecoding) {
+                    return;
+                }
+                job = std::move(mDecodeJobs.front());
+                mDecodeJobs.pop_front();
+            }
+
+            DecodeResult result{ job.textureId, job.path, { 0, 0 }, sSrgbFormat, {} };
+            if (!decodeKtx(job.path, result)) {
+                decodeStb(job.path, result);
+            }
+
+            // Anything past the device limit can't be created, and a row wider than the budget would never upload
+            if (!result.levels.empty() && (result.extent.width == 0 || result.extent.height == 0 ||
+                result.extent.width > mMaxImageDimension || result.extent.height > mMaxImageDimension)) {
+                std::cerr << "Texture " << job.path << " is " << result.extent.width << "x" << result.extent.height
+                          << ", limit is " << mMaxImageDimension << std::endl;
+                result.levels.clear();
+            }
+
+            if (result.levels.size() == 1 && fullMipCount(result.extent) > 1) {
+                buildMipTail(result);
+            }
+
+            std::lock_guard<std::mutex> lock(mResultMutex);
+            mDecodeResults.push_back(std::move(result));
+        }
+    }
+
+    // Fills in every mip no bigger than sTailSize from the base level, so they can be uploaded (and sampled)
+    // first. The levels between the base and the tail stay empty and get blitted once the base is uploaded.
+    static void buildMipTail(DecodeResult& result) {
+        uint32_t mipLevels = fullMipCount(result.extent);
+        uint32_t tailStart = 1;
+        while (tailStart < mipLevels - 1) {
+            VkExtent2D extent = mipExtent(result.extent, tailStart);
+            if (std::max(extent.width, extent.height) <= sTailSize) {
+                break;
+            }
+            tailStart++;
+        }
+
+        bool srgb = result.format == sSrgbFormat;
+        result.levels.resize(mipLevels);
+        uint32_t source = 0;
+        for (uint32_t mip = tailStart; mip < mipLevels; mip++) {
+            result.levels[mip] = downsample(result.levels[source], mipExtent(result.extent, source), mipExtent(result.extent, mip), srgb);
+            source = mip;
+        }
+        result.blitMips = tailStart - 1;
+    }
+
+    // Box filter over whole source texels, averaging color in linear space for sRGB data like the GPU blit does
+    static std::vector<uint8_t> downsample(const std::vector<uint8_t>& src, VkExtent2D srcExtent, VkExtent2D dstExtent, bool srgb) {
+        static const std::array<float, 256> toLinear = [] {
+            std::array<float, 256> table;
+            for (uint32_t i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return table;
+        }();
+
+        std::vector<uint8_t> dst(static_cast<size_t>(dstExtent.width) * dstExtent.height * sTexelSize);
+        for (uint32_t y = 0; y < dstExtent.height; y++) {
+            uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(y) * srcExtent.height / dstExtent.height);
+            uint32_t y1 = std::max(y0 + 1, static_cast<uint32_t>(static_cast<uint64_t>(y + 1) * srcExtent.height / dstExtent.height));
+            for (uint32_t x = 0; x < dstExtent.width; x++) {
+                uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(x) * srcExtent.width / dstExtent.width);
+                uint32_t x1 = std::max(x0 + 1, static_cast<uint32_t>(static_cast<uint64_t>(x + 1) * srcExtent.width / dstExtent.width));
+
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (uint32_t sy = y0; sy < y1; sy++) {
+                    const uint8_t* row = src.data() + static_cast<size_t>(sy) * srcExtent.width * sTexelSize;
+                    for (uint32_t sx = x0; sx < x1; sx++) {
+                        const uint8_t* texel = row + static_cast<size_t>(sx) * sTexelSize;
+                        for (uint32_t c = 0; c < 3; c++) {
+                            sum[c] += srgb ? toLinear[texel[c]] : texel[c] / 255.0f;
+                        }
+                        sum[3] += texel[3] / 255.0f;
+                    }
+                }
+
+                float count = static_cast<float>((y1 - y0) * (x1 - x0));
+                uint8_t* out = dst.data() + (static_cast<size_t>(y) * dstExtent.width + x) * sTexelSize;
+                for (uint32_t c = 0; c < 4; c++) {
+                    float value = sum[c] / count;
+                    if (srgb && c < 3) {
+                        value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+                    }
+                    out[c] = static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+                }
+            }
+        }
+        return dst;
+    }
+
+    static void decodeStb(const std::string& path, DecodeResult& result) {
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            return;
+        }
+        result.extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+        result.levels.emplace_back(pixels, pixels + static_cast<size_t>(width) * height * sTexelSize);
+        stbi_image_free(pixels);
+    }
+
+    // Uncompressed GL_RGBA / GL_UNSIGNED_BYTE 2D KTX 1.1 only, stored as GL_RGBA8 or GL_SRGB8_ALPHA8.
+    // Returns false if the file isn't a KTX at all.
+    static bool decodeKtx(const std::string& path, DecodeResult& result) {
+        static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+        struct Header {
+            uint8_t identifier[12];
+            uint32_t endianness;
+            uint32_t glType;
+            uint32_t glTypeSize;
+            uint32_t glFormat;
+            uint32_t glInternalFormat;
+            uint32_t glBaseInternalFormat;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t numberOfArrayElements;
+            uint32_t numberOfFaces;
+            uint32_t numberOfMipmapLevels;
+            uint32_t bytesOfKeyValueData;
+        } header;
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.identifier, identifier, sizeof(identifier)) != 0) {
+            return false;
+        }
+        if (header.endianness != 0x04030201 || header.glType != 0x1401 /* GL_UNSIGNED_BYTE */ || header.glFormat != 0x1908 /* GL_RGBA */ ||
+            header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.numberOfArrayElements > 1 || header.numberOfFaces != 1) {
+            std::cerr << "Unsupported KTX layout in " << path << std::endl;
+            return true;
+        }
+        if (header.glInternalFormat == 0x8C43 /* GL_SRGB8_ALPHA8 */) {
+            result.format = sSrgbFormat;
+        }
+        else if (header.glInternalFormat == 0x8058 /* GL_RGBA8 */) {
+            result.format = sUnormFormat;
+        }
+        else {
+            std::cerr << "Unsupported KTX internal format 0x" << std::hex << header.glInternalFormat << std::dec << " in " << path << std::endl;
+            return true;
+        }
+
+        result.extent = { header.pixelWidth, header.pixelHeight };
+        file.seekg(header.bytesOfKeyValueData, std::ios::cur);
+
+        uint32_t levelCount = std::min(std::max(1u, header.numberOfMipmapLevels), fullMipCount(result.extent));
+        for (uint32_t mip = 0; mip < levelCount; mip++) {
+            uint32_t imageSize = 0;
+            file.read(reinterpret_cast<char*>(&imageSize), sizeof(imageSize));
+            VkExtent2D extent = mipExtent(result.extent, mip);
+            if (!file || imageSize != extent.width * extent.height * sTexelSize) {
+                std::cerr << "Truncated KTX mip " << mip << " in " << path << std::endl;
+                result.levels.clear();
+                return true;
+            }
+            std::vector<uint8_t> level(imageSize);
+            if (!file.read(reinterpret_cast<char*>(level.data()), imageSize)) {
+                std::cerr << "Truncated KTX mip " << mip << " in " << path << std::endl;
+                result.levels.clear();
+                return true;
+            }
+            // RGBA8 rows are already 4-byte aligned, so there's no mip padding to skip
+            result.levels.push_back(std::move(level));
+        }
+
+        // A partial chain is only useful for its base level, the rest gets blitted
+        if (result.levels.size() != fullMipCount(result.extent)) {
+            result.levels.resize(1);
+        }
+        return true;
+    }
+
+    // Returns false and leaves the texture empty if any of the allocations fail, so nothing gets uploaded
+    bool createTexture(VkCommandBuffer commandBuffer, DecodeResult& result) {
+        StreamedTexture& texture = mTextures[result.textureId];
+        texture.format = result.format;
+        texture.extent = result.extent;
+        texture.mipLevels = fullMipCount(result.extent);
+        texture.residentMip = texture.mipLevels;
+
+        // Image
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = { texture.extent.width, texture.extent.height, 1 };
+            imageInfo.mipLevels = texture.mipLevels;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = texture.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            VkResult imageResult = vkCreateImage(mLogicalDevice, &imageInfo, nullptr, &texture.image);
+            CHECK_VK(imageResult);
+            if (imageResult != VK_SUCCESS) {
+                texture = {};
+                return false;
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetImageMemoryRequirements(mLogicalDevice, texture.image, &memRequirements);
+
+            VkMemoryAllocateInfo memInfo{};
+            memInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            memInfo.allocationSize = memRequirements.size;
+            memInfo.memoryTypeIndex = findMemoryType(mMemoryProperties, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            VkResult memoryResult = vkAllocateMemory(mLogicalDevice, &memInfo, nullptr, &texture.memory);
+            CHECK_VK(memoryResult);
+            bool bound = false;
+            if (memoryResult == VK_SUCCESS) {
+                VkResult bindResult = vkBindImageMemory(mLogicalDevice, texture.image, texture.memory, 0);
+                CHECK_VK(bindResult);
+                bound = bindResult == VK_SUCCESS;
+                if (!bound) {
+                    vkFreeMemory(mLogicalDevice, texture.memory, nullptr);
+                }
+            }
+            if (!bound) {
+                vkDestroyImage(mLogicalDevice, texture.image, nullptr);
+                texture = {};
+                return false;
+            }
+        }
+
+        transition(commandBuffer, texture.image, 0, texture.mipLevels,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        Upload upload;
+        upload.textureId = result.textureId;
+        upload.blitMips = result.blitMips;
+        for (uint32_t i = static_cast<uint32_t>(result.levels.size()); i > 0; i--) {
+            if (!result.levels[i - 1].empty()) {
+                upload.plan.push_back(i - 1);
+            }
+        }
+        upload.levels = std::move(result.levels);
+        mUploads.push_back(std::move(upload));
+        return true;
+    }
+
+    void finishMip(FrameSlot& slot, const Upload& upload, uint32_t mip) {
+        StreamedTexture& texture = mTextures[upload.textureId];
+
+        if (mip == 0 && upload.blitMips > 0) {
+            generateMips(slot.commandBuffer, texture, upload.blitMips);
+            slot.residency.push_back({ upload.textureId, 0 });
+            return;
+        }
+
+        transition(slot.commandBuffer, texture.image, mip, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        slot.residency.push_back({ upload.textureId, mip });
+    }
+
+    // Base level is in TRANSFER_DST with its data; levels 0..lastMip end up in SHADER_READ_ONLY. The tail below
+    // lastMip was uploaded separately and is left alone.
+    void generateMips(VkCommandBuffer commandBuffer, const StreamedTexture& texture, uint32_t lastMip) {
+        for (uint32_t mip = 1; mip <= lastMip; mip++) {
+            transition(commandBuffer, texture.image, mip - 1, 1,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+            VkExtent2D src = mipExtent(texture.extent, mip - 1);
+            VkExtent2D dst = mipExtent(texture.extent, mip);
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = { 0, 0, 0 };
+            blit.srcOffsets[1] = { static_cast<int32_t>(src.width), static_cast<int32_t>(src.height), 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = mip - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = { 0, 0, 0 };
+            blit.dstOffsets[1] = { static_cast<int32_t>(dst.width), static_cast<int32_t>(dst.height), 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = mip;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+            vkCmdBlitImage(commandBuffer,
+                texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit, mBlitFilter);
+
+            transition(commandBuffer, texture.image, mip - 1, 1,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
+
+        transition(commandBuffer, texture.image, lastMip, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+
+    static void transition(
+        VkCommandBuffer commandBuffer,
+        VkImage image,
+        uint32_t baseMip,
+        uint32_t mipCount,
+        VkImageLayout oldLayout,
+        VkImageLayout newLayout,
+        VkAccessFlags srcAccess,
+        VkAccessFlags dstAccess,
+        VkPipelineStageFlags srcStage,
+        VkPipelineStageFlags dstStage) {
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = baseMip;
+        barrier.subresourceRange.levelCount = mipCount;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // Lowers residentMip for everything the slot finished and swaps in views that cover the new range.
+    // Slots may be drained out of submission order, so residency only ever moves towards mip 0.
+    void publishResidency(FrameSlot& slot) {
+        std::vector<uint32_t> changed;
+        for (const Residency& residency : slot.residency) {
+            StreamedTexture& texture = mTextures[residency.textureId];
+            if (residency.mip < texture.residentMip) {
+                texture.residentMip = residency.mip;
+                changed.push_back(residency.textureId);
+            }
+        }
+        slot.residency.clear();
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+        for (uint32_t id : changed) {
+            StreamedTexture& texture = mTextures[id];
+            if (texture.view != VK_NULL_HANDLE) {
+                mRetiredViews.push_back({ texture.view, mUpdateCount });
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = texture.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = texture.format;
+            viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.baseMipLevel = texture.residentMip;
+            viewInfo.subresourceRange.levelCount = texture.mipLevels - texture.residentMip;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+            texture.view = VK_NULL_HANDLE;
+            CHECK_VK(vkCreateImageView(mLogicalDevice, &viewInfo, nullptr, &texture.view));
+        }
+    }
+
+    // Frames still in flight may have descriptors pointing at a replaced view
+    void destroyRetiredViews() {
+        auto expired = std::partition(mRetiredViews.begin(), mRetiredViews.end(), [this](const RetiredView& retired) {
+            return mUpdateCount < retired.retiredAt + sFramesInFlight;
+        });
+        for (auto it = expired; it != mRetiredViews.end(); it++) {
+            vkDestroyImageView(mLogicalDevice, it->view, nullptr);
+        }
+        mRetiredViews.erase(expired, mRetiredViews.end());
+    }
+
+    void reportBandwidth() {
+        // Make sure the last copies have actually landed before stopping the clock
+        for (FrameSlot& slot : mFrames) {
+            CHECK_VK(vkWaitForFences(mLogicalDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+            publishResidency(slot);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStreamStart).count();
+        double mb = static_cast<double>(mBytesStreamed) / (1024.0 * 1024.0);
+        std::cout << "Texture streaming: " << mb << " MB in " << ms << " ms (" << (ms > 0.0 ? mb * 1000.0 / ms : 0.0) << " MB/s)" << std::endl;
+        mStreaming = false;
+    }
+
+    // stb_image sources are treated as color, KTX says which one it is
+    static constexpr VkFormat sSrgbFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    static constexpr VkFormat sUnormFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    static constexpr VkDeviceSize sTexelSize = 4;
+    // Largest mip dimension built on the CPU for sources without mips
+    static constexpr uint32_t sTailSize = 64;
+    static constexpr uint32_t sFramesInFlight = 2;
+
+    VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice mLogicalDevice = VK_NULL_HANDLE;
+    VkQueue mQueue = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties mMemoryProperties;
+    VkFilter mBlitFilter = VK_FILTER_LINEAR;
+    // Read by the decode threads, only written in init() before they start
+    uint32_t mMaxImageDimension = 0;
+
+    VkCommandPool mCommandPool = VK_NULL_HANDLE;
+    FrameSlot mFrames[sFramesInFlight];
+    uint32_t mFrameIndex = 0;
+    VkDeviceSize mFrameBudget = sDefaultFrameBudget;
+
+    std::vector<StreamedTexture> mTextures;
+    std::vector<Upload> mUploads;
+    std::vector<RetiredView> mRetiredViews;
+    uint64_t mUpdateCount = 0;
+
+    // Decode pool
+    std::vector<std::thread> mDecodeThreads;
+    std::mutex mDecodeMutex;
+    std::condition_variable mDecodeCondition;
+    std::deque<DecodeJob> mDecodeJobs;
+    bool mStopDecoding = false;
+    std::mutex mResultMutex;
+    std::vector<DecodeResult> mDecodeResults;
+    uint32_t mOutstandingDecodes = 0;
+
+    // Stats
+    bool mStreaming = false;
+    uint64_t mBytesStreamed = 0;
+    std::chrono::steady_clock::time_point mStreamStart;
+};
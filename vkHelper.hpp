@@ -1,7 +1,10 @@
 // Utility only -- don't make any VK API calls in here
+#pragma once
 
 #include <vulkan/vulkan.h>
 #include <string>
+#include <vector>
+#include <stdexcept>
 #include <iostream>
 #include <utility>
 #include <type_traits>
@@ -38,7 +41,7 @@ struct QueueFamilyIndices {
     }
 };
 
-void printDevice(
+inline void printDevice(
     const VkPhysicalDeviceProperties properties,
     const VkPhysicalDeviceFeatures features) {
 
@@ -74,6 +77,19 @@ void printDevice(
     std::cout << "\t" << "Features: ...\n";
 }
 
+inline uint32_t findMemoryType(
+    const VkPhysicalDeviceMemoryProperties& memoryProperties,
+    uint32_t typeFilter,
+    VkMemoryPropertyFlags properties) {
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Unable to find suitable memory type");
+}
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -114,7 +130,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     return VK_FALSE;
 }
 
-void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+inline void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
     createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
     createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | 
@@ -127,7 +143,7 @@ void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& create
     createInfo.pfnUserCallback = debugCallback;
 }
 
-void printError(VkResult result, char const* const Function, char const* const File, int const Line) {
+inline void printError(VkResult result, char const* const Function, char const* const File, int const Line) {
     if (result != VK_SUCCESS) {
         std::string error;
         switch (result) {